@@ -0,0 +1,219 @@
+//----------------------------------------------------------------------------+
+// bench: Host microbenchmarks for the hot control functions in skeleton.c    |
+//                                                                            |
+// skeleton.c is compiled as-is against the stand-in headers in host/stubs,   |
+// with the nxtOSEK calls below replaced by cheap fakes. Every benchmark is   |
+// run several times and the fastest run is reported, which is the most      |
+// repeatable number on a busy PC. Instruction counts come from the Linux     |
+// perf counters when they are available and are host (not ARM) counts, so   |
+// compare them between changes rather than against the 48MHz budget         |
+//                                                                            |
+// Build:  gcc -std=gnu99 -O2 -Wall -Ihost/stubs -I. -o bench host/bench.c    |
+// Usage:  ./bench [iterations]                                               |
+//----------------------------------------------------------------------------+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "kernel.h"
+
+// Stands in for the PIT register GetTimeUs() reads on the robot
+static U32 bench_pit_piir = 0;
+#define PIT_PIIR bench_pit_piir
+
+#include "../skeleton.c"
+
+#define BENCH_RUNS 11
+
+//----------------------------------------------------------------------------+
+// Fake robot: a light trace that crosses the line now and then, a car that   |
+// is always moving and a steering motor that stays put                       |
+//----------------------------------------------------------------------------+
+static const U16 fake_light[64] = {
+	250, 260, 270, 280, 290, 310, 330, 350, 340, 320, 300, 280, 260, 250, 245, 250,
+	255, 260, 265, 270, 275, 280, 285, 290, 295, 305, 315, 325, 335, 345, 355, 360,
+	350, 340, 330, 320, 310, 290, 270, 250, 240, 235, 240, 245, 250, 255, 260, 265,
+	270, 275, 280, 285, 290, 295, 300, 305, 310, 290, 270, 250, 240, 235, 230, 240,
+};
+static unsigned int fake_sample = 0;
+static int fake_count[3] = { 0 };
+static U32 fake_ms = 0;
+static volatile int sink = 0;
+
+StatusType SetEvent(TaskType task, EventMaskType mask) { (void)task; (void)mask; return E_OK; }
+StatusType WaitEvent(EventMaskType mask) { (void)mask; return E_OK; }
+StatusType GetEvent(TaskType task, EventMaskType* mask) { (void)task; *mask = 0; return E_OK; }
+StatusType ClearEvent(EventMaskType mask) { (void)mask; return E_OK; }
+StatusType TerminateTask(void) { return E_OK; }
+StatusType SignalCounter(CounterType counter) { (void)counter; return E_OK; }
+StatusType SetRelAlarm(AlarmType alarm, U32 increment, U32 cycle) { (void)alarm; (void)increment; (void)cycle; return E_OK; }
+void ShutdownOS(StatusType error) { exit(error); }
+void SuspendAllInterrupts(void) {}
+void ResumeAllInterrupts(void) {}
+
+void ecrobot_init_nxtcolorsensor(U8 port, U8 mode) { (void)port; (void)mode; }
+void ecrobot_term_nxtcolorsensor(U8 port) { (void)port; }
+void ecrobot_process_bg_nxtcolorsensor(void) {}
+U16 ecrobot_get_nxtcolorsensor_light(U8 port) { (void)port; return fake_light[fake_sample++ & 63]; }
+
+void ecrobot_init_sonar_sensor(U8 port) { (void)port; }
+void ecrobot_term_sonar_sensor(U8 port) { (void)port; }
+S32 ecrobot_get_sonar_sensor(U8 port) { (void)port; return 255; }
+
+void nxt_motor_set_speed(U32 n, int speed_percent, int brake) { (void)n; sink = speed_percent + brake; }
+int nxt_motor_get_count(U32 n) {
+	if (n == LEFT_MOTOR) { fake_count[n] -= 7; }
+	return fake_count[n];
+}
+
+void display_clear(U32 update) { (void)update; }
+void display_goto_xy(int x, int y) { (void)x; (void)y; }
+void display_string(const CHAR* str) { (void)str; }
+void display_int(int val, U32 places) { (void)val; (void)places; }
+void display_update(void) {}
+
+U32 ecrobot_get_systick_ms(void) { return fake_ms; }
+
+void ecrobot_init_bt_slave(const CHAR* passkey) { (void)passkey; }
+void ecrobot_term_bt_connection(void) {}
+U8 ecrobot_get_bt_status(void) { return 0; }
+U32 ecrobot_send_bt(void* buf, U32 off, U32 len) { (void)buf; (void)off; return len; }
+
+//----------------------------------------------------------------------------+
+// Benchmarks, each one call of the function under test                       |
+//----------------------------------------------------------------------------+
+static void BenchEmpty(int i) {
+	sink = i;
+}
+static void BenchRecordStat(int i) {
+	RecordStat(&light, fake_light[i & 63]);
+}
+static void BenchGetVector(int i) {
+	vector v = GetVector(i - 512);
+	sink = v.mag;
+}
+static void BenchReadSensors(int i) {
+	(void)i;
+	TaskMain_ReadSensors();
+	tlm_tail = tlm_head; // Nobody flushes telemetry here, keep the queue empty
+}
+static void BenchSteerStep(int i) {
+	static const int targets[8] = { 40, -40, 20, -20, 10, -10, 3, -3 };
+	steer_target = targets[i & 7];
+	sink = SteerStep();
+}
+
+typedef struct { const char* name; void (*fn)(int); } Bench;
+static const Bench benches[] = {
+	{ "(call overhead)", BenchEmpty },
+	{ "RecordStat",      BenchRecordStat },
+	{ "GetVector",       BenchGetVector },
+	{ "ReadSensors",     BenchReadSensors },
+	{ "SteerStep",       BenchSteerStep },
+};
+
+//----------------------------------------------------------------------------+
+// Instruction counter, returns -1 where perf counters aren't permitted       |
+//----------------------------------------------------------------------------+
+static int OpenInstructionCounter(void) {
+#ifdef __linux__
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+	return -1;
+#endif
+}
+
+static double NowNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Fastest of BENCH_RUNS runs, in ns and instructions per call
+static void RunBench(const Bench* bench, long iters, int counter, double* ns, double* instr) {
+	*ns = 1e30;
+	*instr = -1;
+	int run;
+	for (run = 0; run < BENCH_RUNS; ++run) {
+#ifdef __linux__
+		if (counter >= 0) {
+			ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+			ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+		double start = NowNs();
+		long i;
+		for (i = 0; i < iters; ++i) {
+			bench->fn((int)i);
+		}
+		double elapsed = (NowNs() - start) / iters;
+#ifdef __linux__
+		if (counter >= 0) {
+			long long count = 0;
+			ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+			if (read(counter, &count, sizeof(count)) == sizeof(count)) {
+				double per_call = (double)count / iters;
+				if (*instr < 0 || per_call < *instr) { *instr = per_call; }
+			}
+		}
+#endif
+		if (elapsed < *ns) { *ns = elapsed; }
+		++fake_ms;
+	}
+}
+
+int main(int argc, char** argv) {
+	long iters = argc > 1 ? atol(argv[1]) : 1000000;
+	if (iters <= 0) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 2;
+	}
+
+	int counter = OpenInstructionCounter();
+	double base_ns = 0, base_instr = 0;
+
+	printf("%-16s %10s %12s\n", "function", "ns/call", "instr/call");
+	size_t b;
+	for (b = 0; b < sizeof(benches) / sizeof(benches[0]); ++b) {
+		double ns, instr;
+		RunBench(&benches[b], iters, counter, &ns, &instr);
+
+		// Report the loop and indirect call cost once, subtract it elsewhere
+		if (b == 0) {
+			base_ns = ns;
+			base_instr = instr;
+		}
+		else {
+			ns = ns > base_ns ? ns - base_ns : 0;
+			if (instr >= 0) { instr = instr > base_instr ? instr - base_instr : 0; }
+		}
+
+		if (instr >= 0) {
+			printf("%-16s %10.2f %12.1f\n", benches[b].name, ns, instr);
+		}
+		else {
+			printf("%-16s %10.2f %12s\n", benches[b].name, ns, "-");
+		}
+	}
+
+	if (counter < 0) {
+		printf("(instruction counts need perf_event_open, see perf_event_paranoid)\n");
+	}
+	return 0;
+}
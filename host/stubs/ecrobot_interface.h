@@ -0,0 +1,45 @@
+//----------------------------------------------------------------------------+
+// Host stand-in for ecrobot_interface.h, only what skeleton.c calls          |
+//----------------------------------------------------------------------------+
+#ifndef HOST_ECROBOT_INTERFACE_H
+#define HOST_ECROBOT_INTERFACE_H
+
+#include "kernel.h"
+
+#define NXT_PORT_A  0
+#define NXT_PORT_B  1
+#define NXT_PORT_C  2
+#define NXT_PORT_S1 0
+#define NXT_PORT_S2 1
+#define NXT_PORT_S3 2
+#define NXT_PORT_S4 3
+
+#define NXT_LIGHTSENSOR_BLUE 3
+#define BT_STREAM 2
+
+void ecrobot_init_nxtcolorsensor(U8 port, U8 mode);
+void ecrobot_term_nxtcolorsensor(U8 port);
+void ecrobot_process_bg_nxtcolorsensor(void);
+U16  ecrobot_get_nxtcolorsensor_light(U8 port);
+
+void ecrobot_init_sonar_sensor(U8 port);
+void ecrobot_term_sonar_sensor(U8 port);
+S32  ecrobot_get_sonar_sensor(U8 port);
+
+void nxt_motor_set_speed(U32 n, int speed_percent, int brake);
+int  nxt_motor_get_count(U32 n);
+
+void display_clear(U32 update);
+void display_goto_xy(int x, int y);
+void display_string(const CHAR* str);
+void display_int(int val, U32 places);
+void display_update(void);
+
+U32  ecrobot_get_systick_ms(void);
+
+void ecrobot_init_bt_slave(const CHAR* passkey);
+void ecrobot_term_bt_connection(void);
+U8   ecrobot_get_bt_status(void);
+U32  ecrobot_send_bt(void* buf, U32 off, U32 len);
+
+#endif
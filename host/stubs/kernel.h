@@ -0,0 +1,43 @@
+//----------------------------------------------------------------------------+
+// Host stand-in for the TOPPERS/OSEK kernel.h, just enough for skeleton.c    |
+// to compile on a PC. The function bodies live in the host program          |
+//----------------------------------------------------------------------------+
+#ifndef HOST_KERNEL_H
+#define HOST_KERNEL_H
+
+#include <stdint.h>
+
+typedef uint8_t  U8;
+typedef int8_t   S8;
+typedef uint16_t U16;
+typedef int16_t  S16;
+typedef uint32_t U32;
+typedef int32_t  S32;
+typedef char     CHAR;
+
+typedef U32 EventMaskType;
+typedef U8  StatusType;
+typedef int TaskType;
+typedef int AlarmType;
+typedef int CounterType;
+
+#define E_OK 0
+
+#define TASK(name)          void TaskMain_##name(void)
+#define DeclareTask(name)    enum { name = __COUNTER__ }
+#define DeclareCounter(name) enum { name = __COUNTER__ }
+#define DeclareAlarm(name)   enum { name = __COUNTER__ }
+#define DeclareEvent(name)   enum { name = 1 << (__COUNTER__ % 31) }
+
+StatusType SetEvent(TaskType task, EventMaskType mask);
+StatusType WaitEvent(EventMaskType mask);
+StatusType GetEvent(TaskType task, EventMaskType* mask);
+StatusType ClearEvent(EventMaskType mask);
+StatusType TerminateTask(void);
+StatusType SignalCounter(CounterType counter);
+StatusType SetRelAlarm(AlarmType alarm, U32 increment, U32 cycle);
+void ShutdownOS(StatusType error);
+void SuspendAllInterrupts(void);
+void ResumeAllInterrupts(void);
+
+#endif
@@ -0,0 +1 @@
+// Host stand-in for the generated kernel_id.h, ids come from kernel.h
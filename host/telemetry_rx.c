@@ -0,0 +1,147 @@
+//----------------------------------------------------------------------------+
+// telemetry_rx: Host side receiver for the frames sent by skeleton.c         |
+//                                                                            |
+// Build:  gcc -std=c99 -Wall -o telemetry_rx host/telemetry_rx.c             |
+// Usage:  telemetry_rx /dev/rfcomm0    (Bluetooth serial port, set raw first)|
+//         telemetry_rx capture.bin     (a saved capture)                     |
+//         telemetry_rx -               (stdin, e.g. a pipe or loopback)      |
+//----------------------------------------------------------------------------+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "../telemetry.h"
+
+static const char* FinderName(int id) {
+	switch (id & ~TLM_FINDER_FOUND) {
+		case TLM_FINDER_SYMMETRIC:  return "symmetric";
+		case TLM_FINDER_ASYMMETRIC: return "asymmetric";
+		case TLM_FINDER_HARD3TURN:  return "hard3turn";
+		default:                    return "unknown";
+	}
+}
+
+static const char* DISPLAY_NAMES[] = {
+	"light", "line", "sonar", "steer", "drive", "state", "debug",
+};
+
+static const char* LATENCY_NAMES[TLM_LAT_PAIRS] = {
+	"line update", "timer start", "timer complete", "steer start",
+	"steer complete", "steer round trip", "motor start", "motor stop",
+};
+
+static void PrintLatency(int arg, int value) {
+	int pair = arg >> 4;
+	int bucket = arg & 0xF;
+	const char* name = pair < TLM_LAT_PAIRS ? LATENCY_NAMES[pair] : "unknown";
+
+	if (bucket == TLM_LAT_MAX) {
+		printf("event  %-16s worst %d.%d ms\n", name, value / 10, value % 10);
+	}
+	else if (bucket == TLM_LAT_BUCKETS - 1) {
+		printf("event  %-16s >= %7lu us: %d\n", name,
+			(unsigned long)TLM_LAT_FIRST_US << (2 * (bucket - 1)), value);
+	}
+	else {
+		printf("event  %-16s <  %7lu us: %d\n", name,
+			(unsigned long)TLM_LAT_FIRST_US << (2 * bucket), value);
+	}
+}
+
+static const char* SEGMENT_NAMES[] = { "straight", "curve", "dashed", "sharp" };
+static const char* FEATURE_NAMES[] = { "duty", "steer", "revs" };
+
+static const char* FAULT_NAMES[] = { "none", "drive stall", "wheel slip", "steer stall" };
+
+static void PrintFrame(const unsigned char* f) {
+	int type = f[1];
+	int arg = f[2];
+	int16_t value = (int16_t)(f[4] | (f[5] << 8));
+	uint32_t tick = f[6] | (f[7] << 8) | ((uint32_t)f[8] << 16) | ((uint32_t)f[9] << 24);
+
+	printf("%10u ms  #%3u  ", tick, f[3]);
+	switch (type) {
+		case TLM_STATE:
+			printf("state  %d entered at %d.%d s\n", arg, value / 10, value % 10);
+			break;
+		case TLM_FINDER:
+			printf("finder %s %s after %d tries\n", FinderName(arg),
+				arg & TLM_FINDER_FOUND ? "found" : "missed", value);
+			break;
+		case TLM_STEER:
+			printf("steer  settled in %d ms\n", value);
+			break;
+		case TLM_LAP:
+			printf("lap    %s in %d.%d s\n", arg ? "done" : "aborted", value / 10, value % 10);
+			break;
+		case TLM_DROP:
+			printf("drop   %d frames lost on the robot so far\n", value);
+			break;
+		case TLM_DISPLAY:
+			if (arg < (int)(sizeof(DISPLAY_NAMES) / sizeof(DISPLAY_NAMES[0]))) {
+				printf("lcd    %s = %d\n", DISPLAY_NAMES[arg], value);
+			}
+			else {
+				printf("lcd    field %d = %d\n", arg, value);
+			}
+			break;
+		case TLM_LATENCY:
+			PrintLatency(arg, value);
+			break;
+		case TLM_SEGMENT:
+			printf("class  %s (margin %d)\n", arg < 4 ? SEGMENT_NAMES[arg] : "unknown", value);
+			break;
+		case TLM_FEATURE:
+			printf("class  feature %s = %d\n", arg < 3 ? FEATURE_NAMES[arg] : "unknown", value);
+			break;
+		case TLM_MANEUVER:
+			printf("move   step %d took %d ms\n", arg, value);
+			break;
+		case TLM_FAULT:
+			printf("fault  %s in state %d\n", arg < 4 ? FAULT_NAMES[arg] : "unknown", value);
+			break;
+		case TLM_CPU:
+			printf("cpu    %d%% busy, %d ms idle\n", arg, value);
+			break;
+		case TLM_EDGE:
+			if (arg) {
+				printf("edge   nudged the steering to %d on the line\n", value);
+			}
+			else {
+				printf("edge   left the line at rate %d\n", value);
+			}
+			break;
+		default:
+			printf("type %d arg %d value %d\n", type, arg, value);
+			break;
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <device|file|->\n", argv[0]);
+		return 2;
+	}
+
+	FILE* in = strcmp(argv[1], "-") == 0 ? stdin : fopen(argv[1], "rb");
+	if (!in) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	// Resynchronise on TLM_SYNC whenever a frame is torn
+	unsigned char frame[TLM_FRAME_SIZE];
+	int have = 0;
+	int c;
+	while ((c = fgetc(in)) != EOF) {
+		if (have == 0 && c != TLM_SYNC) { continue; }
+		frame[have++] = (unsigned char)c;
+		if (have == TLM_FRAME_SIZE) {
+			PrintFrame(frame);
+			fflush(stdout);
+			have = 0;
+		}
+	}
+
+	if (in != stdin) { fclose(in); }
+	return 0;
+}
@@ -3,6 +3,7 @@
 #include "kernel.h"
 #include "kernel_id.h"
 #include "ecrobot_interface.h"
+#include "telemetry.h"
 
 #define STEER_MOTOR NXT_PORT_A
 #define  LEFT_MOTOR NXT_PORT_B
@@ -18,10 +19,61 @@
 #define DURATION_STRAIGHTENER           20
 #define DURATION_DASHED_FINDER          15
 
+#define BT_PASSKEY                      "1234"
+#define TLM_QUEUE_LEN                   64
+#define TLM_BATCH                       8
+
+// Display refresh period (at most the counter's MAXALLOWEDVALUE) and whether
+// to skip the LCD entirely, sending the displayed fields as telemetry instead
+#define DISPLAY_PERIOD_MS               500
+#define RACE_MODE                       0
+#define DISP_VALUE_COLUMN               7
+
+// How often BackgroundAlways services the color sensor. A fresh light reading
+// is ready every couple of ms, ReadSensors only samples one every 45ms
+#define COLOR_PROCESS_PERIOD_MS         2
+
+// AT91SAM7 periodic interval timer behind the 1ms systick, clocked at MCK/16
+#ifndef PIT_PIIR
+#define PIT_PIIR (*(volatile U32*)0xFFFFFD3C)
+#endif
+#define PIT_TICKS_PER_US                3
+
+// One report slot per histogram bucket plus the worst case, for every pair
+#define LAT_REPORT_SLOTS                (TLM_LAT_PAIRS * (TLM_LAT_BUCKETS + 1))
+
+// Course segment classifier, see ClassifySegment. Off until seg_centroid is
+// fitted from recorded runs, only the TLM_FEATURE / TLM_SEGMENT logging runs
+#define SEGMENT_CLASSIFIER              0
+#define SEG_WINDOW                      16
+#define SEG_EMA_SHIFT                   3
+#define SEG_CONFIRM                     6
+#define SEG_MARGIN                      40
+
+// Stall and slip detection, see CheckDriveMotors and MotorRevControl
+#define STALL_MIN_COUNTS                4
+#define STALL_PERIODS                   4
+#define SLIP_SHIFT                      2
+
+// Line edge estimator, see EstimateEdge. Rates are in 1/16ths of the 0..256
+// offset scale per drive count, the car covers ~40 counts per sample at SPEED_4
+#define EDGE_EMA_SHIFT                  1
+#define EDGE_MIN_SPAN                   40
+#define EDGE_RATE_SHALLOW               16
+#define EDGE_RATE_STEEP                 48
+
+// Still over the line but this far towards the floor and moving outwards
+// counts as drifting off; re-armed once back under half of it
+#define EDGE_DRIFT_OFFSET               96
+
 typedef volatile struct { int now; int min; int max; int sum; int cnt; } DispStat;
+typedef volatile struct { U32 set_us; bool pending; U16 count[TLM_LAT_BUCKETS]; U32 max_us; } LatHist;
 
 DeclareCounter(SysTimerCnt);
 
+DeclareAlarm(cyclic_display);
+DeclareAlarm(cyclic_color_process);
+
 DeclareTask(BackgroundAlways);
 DeclareTask(Display);
 DeclareTask(ReadSensors);
@@ -29,11 +81,15 @@ DeclareTask(LineFollower);
 DeclareTask(MotorRevControl);
 DeclareTask(MotorSpeedControl);
 
+DeclareEvent(ColorProcessEvent);
+
 DeclareEvent(LineUpdateEvent);
 DeclareEvent(ObjectDetectedEvent);
 DeclareEvent(TimerCompleteEvent);
 DeclareEvent(DriveCompleteEvent);
 DeclareEvent(SteerCompleteEvent);
+DeclareEvent(MotorFailEvent);
+DeclareEvent(EdgeDriftEvent);
 
 DeclareEvent(RevCheckEvent);
 DeclareEvent(TimerStartEvent);
@@ -55,6 +111,112 @@ volatile bool on_line = true;
 volatile bool obstacle = false;
 volatile U32 line_rev_count = 0;
 
+// Fields shown by TASK(Display), one per LCD line below the title
+enum DISP_FIELD {
+	DISP_LIGHT,
+	DISP_LINE,
+	DISP_SONAR,
+	DISP_STEER,
+	DISP_DRIVE,
+	DISP_STATE,
+	DISP_DEBUG,
+	DISP_FIELDS,
+};
+const char* disp_label[DISP_FIELDS] = {
+	"Light: ", "Line?: ", "Sonar: ", "Steer: ", "Drive: ", "State: ", "Debug: ",
+};
+int disp_shown[DISP_FIELDS] = { 0 };
+bool disp_drawn = false;
+
+// Course segments, numbered like `state` minus one
+enum SEGMENT {
+	SEG_NONE = -1, // Nothing confirmed since the current state was entered
+	SEG_STRAIGHT,
+	SEG_CURVE,
+	SEG_DASHED,
+	SEG_SHARP,
+	SEG_COUNT,
+};
+enum SEG_FEATURE {
+	SEG_DUTY,  // Share of the window spent over the line
+	SEG_STEER, // Average steer angle, any consistent turn shows up here
+	SEG_REVS,  // Average drive counts between line losses
+	SEG_FEATURES,
+};
+
+// Where each segment sits in feature space, every feature scaled to 0..256
+// Rough hand-placed guesses, not yet checked against any run. Fit them from
+// TLM_FEATURE frames before turning SEGMENT_CLASSIFIER on
+const S16 seg_centroid[SEG_COUNT][SEG_FEATURES] = {
+	/* SEG_STRAIGHT */ { 224,  24, 200 },
+	/* SEG_CURVE    */ { 160, 152,  60 },
+	/* SEG_DASHED   */ {  96,  24, 100 },
+	/* SEG_SHARP    */ {  64, 253,  24 },
+};
+
+// Classifier state, only touched by ReadSensors apart from SetState clearing
+// `segment` and `seg_votes` (ReadSensors can't preempt LineFollower)
+volatile int segment = SEG_NONE;
+int seg_candidate = SEG_STRAIGHT;
+int seg_votes = 0;
+int seg_samples = 0;
+U16 seg_line_bits = 0;
+int seg_duty = 0;
+int seg_steer_ema = 0;
+int seg_revs_ema = 0;
+int seg_drive_last = 0;
+int seg_loss_last = 0;
+bool seg_on_line = true;
+
+// Line edge estimator state, only written by ReadSensors
+int edge_dark = THRESHOLD_LINE - 100;
+int edge_bright = THRESHOLD_LINE + 100;
+volatile int edge_offset = 0;
+int edge_rate = 0;
+volatile int edge_exit_rate = EDGE_RATE_SHALLOW;
+int edge_drive_last = 0;
+bool edge_on_line = true;
+bool edge_drifting = false;
+
+// On-line corrections made by FollowLine, see EdgeFollowStart
+volatile int drift_dir = 0;
+int drift_angle = 0;
+bool drift_nudged = false;
+
+// Why MotorFailEvent was last raised
+enum MOTOR_FAULT {
+	FAULT_NONE,
+	FAULT_STALL, // Drive motors powered but neither wheel is turning
+	FAULT_SLIP,  // One drive wheel turning far faster than the other
+	FAULT_STEER, // Steering motor stopped short of steer_target
+};
+volatile int motor_fault = FAULT_NONE;
+
+// Drive motor monitor state, only touched by ReadSensors
+int stall_left_last = 0;
+int stall_right_last = 0;
+int stall_periods = 0;
+int slip_periods = 0;
+
+// CPU time spent in tasks, accumulated by the task hooks
+volatile U32 cpu_busy_us = 0;
+U32 cpu_task_start = 0;
+U32 cpu_period_start = 0;
+volatile int cpu_util = 0;
+
+// Event handoff latencies, indexed by TLM_LAT_PAIR
+LatHist lat[TLM_LAT_PAIRS] = { { 0 } };
+volatile int lat_report_slot = -1;
+
+// Telemetry frames waiting for BackgroundAlways to send them
+U8 tlm_queue[TLM_QUEUE_LEN][TLM_FRAME_SIZE];
+volatile unsigned int tlm_head = 0;
+volatile unsigned int tlm_tail = 0;
+volatile int tlm_dropped = 0;
+int tlm_dropped_sent = 0;
+U8 tlm_seq = 0;
+U32 course_start = 0;
+
 // Useful enums for managing the logic of the vehicle
 enum DRIVE_DIRECTION {
 	FORWARD = -1,
@@ -78,6 +240,7 @@ enum STEER_DIRECTION {
 };
 enum STEER_MAGNITUDE {
 	STRAIGHT = 0,
+	NUDGE = 15,
 	BUMP = 25,
 	SOFT = 35,
 	TURN = 45,
@@ -91,6 +254,8 @@ volatile int drive_target = 0;
 volatile int steer_target = 0;
 
 volatile int velocity = FORWARD * SPEED_0;
+volatile bool drive_active = false;
+volatile bool rolling = false;
 
 //----------------------------------------------------------------------------+
 // nxtOSEK hooks                                                              |
@@ -98,10 +263,12 @@ volatile int velocity = FORWARD * SPEED_0;
 void ecrobot_device_initialize() {
 	ecrobot_init_nxtcolorsensor(COLOR_PORT, NXT_LIGHTSENSOR_BLUE);
 	ecrobot_init_sonar_sensor(SONAR_PORT);
+	ecrobot_init_bt_slave(BT_PASSKEY);
 }
 void ecrobot_device_terminate() {
 	ecrobot_term_nxtcolorsensor(COLOR_PORT);
 	ecrobot_term_sonar_sensor(SONAR_PORT);
+	ecrobot_term_bt_connection();
 	nxt_motor_set_speed(LEFT_MOTOR, STOPPED, 1);
 	nxt_motor_set_speed(RIGHT_MOTOR, STOPPED, 1);
 	nxt_motor_set_speed(STEER_MOTOR, STOPPED, 1);
@@ -114,45 +281,225 @@ void user_1ms_isr_type2() {
 	}
 }
 
+//----------------------------------------------------------------------------+
+// GetTimeUs: Microseconds since boot, the 1ms systick refined with the PIT   |
+// counter it is derived from (PICNT counts periods the ISR hasn't seen yet)  |
+//----------------------------------------------------------------------------+
+U32 GetTimeUs() {
+	U32 ms, piir;
+	do {
+		ms = ecrobot_get_systick_ms();
+		piir = PIT_PIIR;
+	} while (ms != ecrobot_get_systick_ms());
+	
+	return (ms + (piir >> 20)) * 1000 + (piir & 0xFFFFF) / PIT_TICKS_PER_US;
+}
+
+//----------------------------------------------------------------------------+
+// TelemetryPost: Queues one frame, never blocks (drops it if the queue is    |
+// full). Safe to call from any task, see telemetry.h for the frame layout    |
+//----------------------------------------------------------------------------+
+void TelemetryPost(int type, int arg, int value) {
+	U32 tick = ecrobot_get_systick_ms();
+	
+	SuspendAllInterrupts();
+	if (tlm_head - tlm_tail >= TLM_QUEUE_LEN) {
+		++tlm_dropped;
+		ResumeAllInterrupts();
+		return;
+	}
+	
+	U8* frame = tlm_queue[tlm_head % TLM_QUEUE_LEN];
+	frame[0] = TLM_SYNC;
+	frame[1] = type;
+	frame[2] = arg;
+	frame[3] = tlm_seq++;
+	frame[4] = value & 0xFF;
+	frame[5] = (value >> 8) & 0xFF;
+	frame[6] = tick & 0xFF;
+	frame[7] = (tick >> 8) & 0xFF;
+	frame[8] = (tick >> 16) & 0xFF;
+	frame[9] = (tick >> 24) & 0xFF;
+	++tlm_head;
+	ResumeAllInterrupts();
+}
+
+//----------------------------------------------------------------------------+
+// TelemetryFlush: Sends up to TLM_BATCH queued frames over Bluetooth         |
+// Only called from BackgroundAlways so it never holds up the control tasks   |
+//----------------------------------------------------------------------------+
+void TelemetryFlush() {
+	static U8 batch[TLM_BATCH * TLM_FRAME_SIZE];
+	
+	// Keep queueing (and eventually dropping) until a host connects
+	if (ecrobot_get_bt_status() != BT_STREAM) { return; }
+	
+	if (tlm_dropped != tlm_dropped_sent) {
+		tlm_dropped_sent = tlm_dropped;
+		TelemetryPost(TLM_DROP, 0, tlm_dropped_sent);
+	}
+	
+	unsigned int count = tlm_head - tlm_tail;
+	if (count == 0) { return; }
+	if (count > TLM_BATCH) { count = TLM_BATCH; }
+	
+	unsigned int i;
+	for (i = 0; i < count; ++i) {
+		U8* frame = tlm_queue[(tlm_tail + i) % TLM_QUEUE_LEN];
+		int b;
+		for (b = 0; b < TLM_FRAME_SIZE; ++b) {
+			batch[i * TLM_FRAME_SIZE + b] = frame[b];
+		}
+	}
+	
+	// The radio takes nothing while its DMA slot is busy, so only retire the
+	// frames that actually went out and retry the rest on the next pass
+	U32 sent = ecrobot_send_bt(batch, 0, count * TLM_FRAME_SIZE);
+	tlm_tail += sent / TLM_FRAME_SIZE;
+}
+
+//----------------------------------------------------------------------------+
+// LatReport: Posts every non-empty histogram bucket and the worst case, as   |
+// many as the queue has room for, carrying on from lat_report_slot on the    |
+// next call. Called from BackgroundAlways so the report drains as it goes    |
+//----------------------------------------------------------------------------+
+void LatReport() {
+	while (lat_report_slot >= 0 && lat_report_slot < LAT_REPORT_SLOTS) {
+		if (tlm_head - tlm_tail >= TLM_QUEUE_LEN) { return; }
+		
+		int pair = lat_report_slot / (TLM_LAT_BUCKETS + 1);
+		int bucket = lat_report_slot % (TLM_LAT_BUCKETS + 1);
+		++lat_report_slot;
+		
+		if (bucket < TLM_LAT_BUCKETS) {
+			int count = lat[pair].count[bucket];
+			if (count) {
+				TelemetryPost(TLM_LATENCY, pair << 4 | bucket, count > 0x7FFF ? 0x7FFF : count);
+			}
+		}
+		else {
+			U32 worst = lat[pair].max_us / 100;
+			if (worst) {
+				TelemetryPost(TLM_LATENCY, pair << 4 | TLM_LAT_MAX, worst > 0x7FFF ? 0x7FFF : worst);
+			}
+		}
+	}
+	lat_report_slot = -1;
+}
+
 //----------------------------------------------------------------------------+
 // BackgroundAlways - aperiodic task while(1), priority 1                     |
+// Runs once every COLOR_PROCESS_PERIOD_MS, the CPU idles in between          |
 //----------------------------------------------------------------------------+
 TASK(BackgroundAlways) {
+	SetRelAlarm(cyclic_display, 1, DISPLAY_PERIOD_MS);
+	SetRelAlarm(cyclic_color_process, 1, COLOR_PROCESS_PERIOD_MS);
+	
 	while(1) {
+		WaitEvent(ColorProcessEvent);
+		ClearEvent(ColorProcessEvent);
+		
 		ecrobot_process_bg_nxtcolorsensor();
+		LatReport();
+		TelemetryFlush();
 	}
 }
 
 //----------------------------------------------------------------------------+
-// Display - periodic every 500ms, priority 2                                 |
+// PreTaskHook / PostTaskHook: Called by the kernel around every task switch, |
+// time spent outside of any task is idle time                                |
 //----------------------------------------------------------------------------+
-TASK(Display) {
-	// Calculate the sum
-	int steer_avg = steer.sum / steer.cnt;
-	int drive_avg = drive.max; // drive.sum / drive.cnt;
-	int light_avg = light.sum / light.cnt;
-	int sonar_avg = sonar.sum / sonar.cnt;
-	steer.cnt = drive.cnt = light.cnt = sonar.cnt = 0;
-	
-	display_clear(0);
-	display_goto_xy(0, 0);
-	display_string("Devin and John");
-	display_string("\nLight: ");
-	display_int(light_avg, 7);
-	display_string("\nLine?: ");
-	display_int(on_line, 7);
-	display_string("\nSonar: ");
-	display_int(sonar_avg, 7);
-	display_string("\nSteer: ");
-	display_int(steer_avg, 7);
-	display_string("\nDrive: ");
-	display_int(drive_avg, 7);
-	display_string("\nState: ");
-	display_int(state, 7);
-	display_string("\nDebug: ");
-	display_int(debug, 7);
-	display_update();
+void PreTaskHook(void) {
+	cpu_task_start = GetTimeUs();
+}
+void PostTaskHook(void) {
+	cpu_busy_us += GetTimeUs() - cpu_task_start;
+}
+
+//----------------------------------------------------------------------------+
+// CpuSample: Utilization and idle time since the previous call               |
+//----------------------------------------------------------------------------+
+void CpuSample() {
+	SuspendAllInterrupts();
+	U32 now = GetTimeUs();
+	U32 busy = cpu_busy_us + (now - cpu_task_start);
+	cpu_busy_us = 0;
+	cpu_task_start = now;
+	ResumeAllInterrupts();
+	
+	U32 elapsed = now - cpu_period_start;
+	cpu_period_start = now;
+	if (elapsed == 0) { return; }
+	
+	// Whole percent, split to keep busy * 100 from overflowing
+	cpu_util = busy / (elapsed / 100 + 1);
+	if (cpu_util > 100) { cpu_util = 100; }
+	TelemetryPost(TLM_CPU, cpu_util, busy < elapsed ? (elapsed - busy) / 1000 : 0);
+}
 
+//----------------------------------------------------------------------------+
+// StatAverage: Average since the last call, `last` if nothing was recorded   |
+//----------------------------------------------------------------------------+
+int StatAverage(DispStat* stat, int last) {
+	int cnt = stat->cnt;
+	int sum = stat->sum;
+	stat->cnt = 0;
+	return cnt ? sum / cnt : last;
+}
+
+//----------------------------------------------------------------------------+
+// Display - periodic every DISPLAY_PERIOD_MS, priority 2                     |
+// Only fields that changed since the last period are redrawn, and the LCD is |
+// only pushed if something changed. In RACE_MODE the LCD is never touched    |
+// and changed fields are posted to the telemetry queue instead               |
+//----------------------------------------------------------------------------+
+TASK(Display) {
+	int now[DISP_FIELDS];
+	now[DISP_LIGHT] = StatAverage(&light, disp_shown[DISP_LIGHT]);
+	now[DISP_LINE]  = on_line;
+	now[DISP_SONAR] = StatAverage(&sonar, disp_shown[DISP_SONAR]);
+	now[DISP_STEER] = StatAverage(&steer, disp_shown[DISP_STEER]);
+	now[DISP_DRIVE] = drive.max;
+	now[DISP_STATE] = state;
+	now[DISP_DEBUG] = debug;
+	drive.cnt = 0;
+	
+	CpuSample();
+	
+	int i;
+	bool redraw = !disp_drawn;
+#if !RACE_MODE
+	bool dirty = false;
+	if (redraw) {
+		display_clear(0);
+		display_goto_xy(0, 0);
+		display_string("Devin and John");
+		for (i = 0; i < DISP_FIELDS; ++i) {
+			display_goto_xy(0, i + 1);
+			display_string(disp_label[i]);
+		}
+	}
+#endif
+	disp_drawn = true;
+	
+	for (i = 0; i < DISP_FIELDS; ++i) {
+		if (!redraw && now[i] == disp_shown[i]) { continue; }
+		disp_shown[i] = now[i];
+#if RACE_MODE
+		TelemetryPost(TLM_DISPLAY, i, now[i]);
+#else
+		display_goto_xy(DISP_VALUE_COLUMN, i + 1);
+		display_int(now[i], 7);
+		dirty = true;
+#endif
+	}
+	
+#if !RACE_MODE
+	if (dirty) {
+		display_update();
+	}
+#endif
+	
 	TerminateTask();
 }
 
@@ -177,6 +524,227 @@ inline void RecordStat(DispStat* stat, int val) {
 	}
 }
 
+//----------------------------------------------------------------------------+
+// LatSet / LatWake: Histogram the time from a SetEvent to the WaitEvent that |
+// consumes it. LatSet goes right before SetEvent, LatWake right after the    |
+// wait returns. Repeated sets before a wake are timed from the latest one    |
+//----------------------------------------------------------------------------+
+void LatSet(int pair) {
+	lat[pair].set_us = GetTimeUs();
+	lat[pair].pending = true;
+}
+void LatWake(int pair) {
+	LatHist* hist = &lat[pair];
+	if (!hist->pending) { return; }
+	hist->pending = false;
+	
+	U32 elapsed = GetTimeUs() - hist->set_us;
+	U32 limit = TLM_LAT_FIRST_US;
+	int bucket = 0;
+	while (bucket < TLM_LAT_BUCKETS - 1 && elapsed >= limit) {
+		++bucket;
+		limit <<= 2;
+	}
+	
+	if (hist->count[bucket] < 0xFFFF) {
+		++hist->count[bucket];
+	}
+	if (elapsed > hist->max_us) {
+		hist->max_us = elapsed;
+	}
+}
+inline void LatWakeOn(EventMaskType eMask, EventMaskType event, int pair) {
+	if (eMask & event) {
+		LatWake(pair);
+	}
+}
+
+//----------------------------------------------------------------------------+
+// ClassifySegment: Nearest-centroid guess at which course segment we are on  |
+// Features are windowed over samples where the car moved, so stopping to run |
+// a finder doesn't skew them. A new segment only sticks after SEG_CONFIRM    |
+// moving samples in a row agree on it by at least SEG_MARGIN                 |
+//----------------------------------------------------------------------------+
+void ClassifySegment(int drive_now, int steer_now) {
+	if (drive_now == seg_drive_last) { return; }
+	seg_drive_last = drive_now;
+	
+	// Line duty cycle over the last SEG_WINDOW moving samples
+	seg_duty += on_line - ((seg_line_bits >> (SEG_WINDOW - 1)) & 1);
+	seg_line_bits = (seg_line_bits << 1) | on_line;
+	
+	// Steer angle and distance between line losses (both 4 fractional bits)
+	seg_steer_ema += ((steer_now << 4) - seg_steer_ema) >> SEG_EMA_SHIFT;
+	if (seg_on_line && !on_line) {
+		int revs = abs(drive_now - seg_loss_last);
+		seg_loss_last = drive_now;
+		seg_revs_ema += ((revs << 4) - seg_revs_ema) >> SEG_EMA_SHIFT;
+	}
+	
+	int f[SEG_FEATURES];
+	f[SEG_DUTY] = seg_duty * (256 / SEG_WINDOW);
+	f[SEG_STEER] = (abs(seg_steer_ema) >> 4) * 27 >> 3;
+	f[SEG_REVS] = seg_revs_ema >> 6;
+	if (f[SEG_STEER] > 256) { f[SEG_STEER] = 256; }
+	if (f[SEG_REVS] > 256) { f[SEG_REVS] = 256; }
+	
+	if (seg_on_line && !on_line) {
+		int i;
+		for (i = 0; i < SEG_FEATURES; ++i) {
+			TelemetryPost(TLM_FEATURE, i, f[i]);
+		}
+	}
+	seg_on_line = on_line;
+	
+	if (seg_samples < SEG_WINDOW) {
+		++seg_samples;
+		return;
+	}
+	
+	// L1 distance to every centroid, keep the best two
+	int best = 0;
+	int best_dist = 0x7FFF;
+	int next_dist = 0x7FFF;
+	int c;
+	for (c = 0; c < SEG_COUNT; ++c) {
+		int dist = 0;
+		int i;
+		for (i = 0; i < SEG_FEATURES; ++i) {
+			dist += abs(f[i] - seg_centroid[c][i]);
+		}
+		if (dist < best_dist) {
+			next_dist = best_dist;
+			best_dist = dist;
+			best = c;
+		}
+		else if (dist < next_dist) {
+			next_dist = dist;
+		}
+	}
+	
+	if (next_dist - best_dist < SEG_MARGIN) {
+		seg_votes = 0;
+		return;
+	}
+	if (best != seg_candidate) {
+		seg_candidate = best;
+		seg_votes = 0;
+	}
+	if (++seg_votes >= SEG_CONFIRM && segment != best) {
+		segment = best;
+		TelemetryPost(TLM_SEGMENT, best, next_dist - best_dist);
+	}
+}
+
+//----------------------------------------------------------------------------+
+// SegmentIs: True if the classifier is confident we're on segment `seg`      |
+//----------------------------------------------------------------------------+
+inline bool SegmentIs(int seg) {
+	return SEGMENT_CLASSIFIER && segment == seg;
+}
+
+//----------------------------------------------------------------------------+
+// EstimateEdge: Places the sensor across the line edge from the raw light    |
+// level instead of just on/off. edge_offset runs from 0 over the middle of   |
+// the line to 256 fully on the floor, edge_rate is how fast that changes per |
+// drive count. The rate when the line is lost is kept in edge_exit_rate      |
+//----------------------------------------------------------------------------+
+void EstimateEdge(int light_now, int drive_now) {
+	// Follow the darkest and brightest readings, leaking back towards the
+	// threshold so the levels keep up with the lighting on the course
+	if (light_now < edge_dark) { edge_dark = light_now; }
+	else if (edge_dark < THRESHOLD_LINE) { ++edge_dark; }
+	if (light_now > edge_bright) { edge_bright = light_now; }
+	else if (edge_bright > THRESHOLD_LINE) { --edge_bright; }
+	
+	int span = edge_bright - edge_dark;
+	if (span < EDGE_MIN_SPAN) { span = EDGE_MIN_SPAN; }
+	
+	int offset = ((light_now - edge_dark) << 8) / span;
+	if (offset < 0) { offset = 0; }
+	if (offset > 256) { offset = 256; }
+	
+	int moved = abs(drive_now - edge_drive_last);
+	if (moved > 0) {
+		int rate = ((offset - edge_offset) << 4) / moved;
+		edge_rate += (rate - edge_rate) >> EDGE_EMA_SHIFT;
+	}
+	edge_offset = offset;
+	edge_drive_last = drive_now;
+	
+	if (edge_on_line && !on_line) {
+		edge_exit_rate = edge_rate;
+		TelemetryPost(TLM_EDGE, 0, edge_rate);
+	}
+	edge_on_line = on_line;
+	
+	// Warn LineFollower once per drift, while there's still line to steer for
+	if (on_line && offset >= EDGE_DRIFT_OFFSET && edge_rate > 0) {
+		if (!edge_drifting) {
+			edge_drifting = true;
+			SetEvent(LineFollower, EdgeDriftEvent);
+		}
+	}
+	else if (!on_line || offset < EDGE_DRIFT_OFFSET / 2) {
+		edge_drifting = false;
+	}
+}
+
+//----------------------------------------------------------------------------+
+// EdgeBump: Correction step for the finders from the last line exit, small   |
+// for a shallow drift off the edge and larger for a steep one                |
+//----------------------------------------------------------------------------+
+int EdgeBump() {
+	if (edge_exit_rate < EDGE_RATE_SHALLOW) {
+		return NUDGE;
+	}
+	if (edge_exit_rate < EDGE_RATE_STEEP) {
+		return BUMP;
+	}
+	return SOFT;
+}
+
+//----------------------------------------------------------------------------+
+// MotorFail: Tells LineFollower to abandon whatever it is waiting on         |
+//----------------------------------------------------------------------------+
+void MotorFail(int fault) {
+	motor_fault = fault;
+	TelemetryPost(TLM_FAULT, fault, state);
+	SetEvent(LineFollower, MotorFailEvent);
+}
+
+//----------------------------------------------------------------------------+
+// CheckDriveMotors: Flags a stall if neither drive wheel moves, or slip if   |
+// one turns over 1 << SLIP_SHIFT times faster than the other, for            |
+// STALL_PERIODS samples in a row while the drive motors are powered          |
+//----------------------------------------------------------------------------+
+void CheckDriveMotors(int left_now, int right_now) {
+	int left = abs(left_now - stall_left_last);
+	int right = abs(right_now - stall_right_last);
+	stall_left_last = left_now;
+	stall_right_last = right_now;
+	
+	if (!drive_active) {
+		stall_periods = slip_periods = 0;
+		return;
+	}
+	
+	int fast = left > right ? left : right;
+	int slow = left > right ? right : left;
+	
+	stall_periods = fast < STALL_MIN_COUNTS ? stall_periods + 1 : 0;
+	slip_periods = fast >= STALL_MIN_COUNTS && (slow << SLIP_SHIFT) < fast ? slip_periods + 1 : 0;
+	
+	if (stall_periods >= STALL_PERIODS) {
+		stall_periods = slip_periods = 0;
+		MotorFail(FAULT_STALL);
+	}
+	else if (slip_periods >= STALL_PERIODS) {
+		stall_periods = slip_periods = 0;
+		MotorFail(FAULT_SLIP);
+	}
+}
+
 //----------------------------------------------------------------------------+
 // ReadSensors - periodic every 45ms, priority 3                              |
 //----------------------------------------------------------------------------+
@@ -196,19 +764,25 @@ TASK(ReadSensors) {
 	// Read the drive revolution count
 	int drive_now = nxt_motor_get_count(LEFT_MOTOR);
 	RecordStat(&drive, drive_now);
+	CheckDriveMotors(drive_now, nxt_motor_get_count(RIGHT_MOTOR));
 	
 	if (light_now < THRESHOLD_LINE) {
 		line_rev_count = drive_now;
 		if (!on_line) {
 			on_line = true;
+			LatSet(TLM_LAT_LINE_UPDATE);
 			SetEvent(LineFollower, LineUpdateEvent);
 		}
 	}
 	else if (on_line) {
 		on_line = false;
+		LatSet(TLM_LAT_LINE_UPDATE);
 		SetEvent(LineFollower, LineUpdateEvent);
 	}
 	
+	EstimateEdge(light_now, drive_now);
+	ClassifySegment(drive_now, steer_now);
+	
 	if (sonar_now < THRESHOLD_SONAR) {
 		if (!obstacle) {
 			obstacle = true;
@@ -237,100 +811,261 @@ inline vector GetVector(int val) {
 	}
 }
 
+//----------------------------------------------------------------------------+
+// SetState: Moves to the next course segment and reports the split time      |
+// in 100ms units, like the lap time, so long runs don't overflow the frame   |
+//----------------------------------------------------------------------------+
+void SetState(int next) {
+	state = next;
+	
+	// Only act on classifications confirmed within the new state
+	segment = SEG_NONE;
+	seg_votes = 0;
+	TelemetryPost(TLM_STATE, next, (ecrobot_get_systick_ms() - course_start) / 100);
+}
+
+//----------------------------------------------------------------------------+
+// CourseEnd: Reports the lap time and starts the event latency report,       |
+// `done` is false if we gave up early                                        |
+//----------------------------------------------------------------------------+
+void CourseEnd(bool done) {
+	TelemetryPost(TLM_LAP, done, (ecrobot_get_systick_ms() - course_start) / 100);
+	lat_report_slot = 0;
+}
+
+//----------------------------------------------------------------------------+
+// FinderDone: Reports how many angles a finder tried, passes `found` through |
+//----------------------------------------------------------------------------+
+bool FinderDone(int id, int tries, bool found) {
+	TelemetryPost(TLM_FINDER, found ? id | TLM_FINDER_FOUND : id, tries);
+	return found;
+}
+
+//----------------------------------------------------------------------------+
+// SteerUntil: Steer, but if an event in `abort` arrives first the car stops, |
+// the turn is cut short where it is and the event is left set for the caller |
+// returns true: If the target was reached, false if aborted or stalled       |
+//----------------------------------------------------------------------------+
+bool SteerUntil(int angle, EventMaskType abort) {
+	// Stop to simplify logic (should be a no-op but safety first), unless a
+	// maneuver step or an edge nudge asked to steer on the move
+	if (!rolling) {
+		LatSet(TLM_LAT_MOTOR_STOP);
+		SetEvent(MotorSpeedControl, MotorStopEvent);
+	}
+	
+	steer_target = angle;
+	LatSet(TLM_LAT_STEER_ROUND);
+	LatSet(TLM_LAT_STEER_START);
+	SetEvent(MotorRevControl, SteerStartEvent);
+	
+	// Only a steering fault means MotorRevControl gave up, so anything else
+	// still waits for its SteerCompleteEvent. A drive fault on the move stops
+	// the car and, like `abort`, is handed back to FollowLine / SeekLine
+	EventMaskType wait = SteerCompleteEvent | MotorFailEvent | abort;
+	EventMaskType held = 0;
+	bool reached = true;
+	while (1) {
+		WaitEvent(wait);
+		
+		EventMaskType eMask = 0;
+		GetEvent(LineFollower, &eMask);
+		
+		EventMaskType stop = eMask & abort;
+		if (eMask & MotorFailEvent && motor_fault != FAULT_STEER) {
+			stop |= MotorFailEvent;
+		}
+		if (stop) {
+			ClearEvent(stop);
+			held |= stop;
+			LatSet(TLM_LAT_MOTOR_STOP);
+			SetEvent(MotorSpeedControl, MotorStopEvent);
+		}
+		if (eMask & abort) {
+			LatWakeOn(eMask & abort, LineUpdateEvent, TLM_LAT_LINE_UPDATE);
+			steer_target = nxt_motor_get_count(STEER_MOTOR);
+			wait &= ~abort;
+			reached = false;
+		}
+		
+		if (eMask & SteerCompleteEvent) { break; }
+		if (eMask & MotorFailEvent && motor_fault == FAULT_STEER) {
+			reached = false;
+			break;
+		}
+	}
+	
+	ClearEvent(SteerCompleteEvent | MotorFailEvent);
+	LatWake(TLM_LAT_STEER_COMPLETE);
+	LatWake(TLM_LAT_STEER_ROUND);
+	
+	if (held) {
+		SetEvent(LineFollower, held);
+	}
+	return reached;
+}
+
+//----------------------------------------------------------------------------+
+// Steer: Does an in-place turn and returns out when finished turning         |
+// returns true: If the target was reached, false if the steering stalled     |
+//----------------------------------------------------------------------------+
+inline bool Steer(int angle) {
+	return SteerUntil(angle, 0);
+}
+
+//----------------------------------------------------------------------------+
+// SteerTo: Steers to `*angle`, or leaves `*angle` where the steering stalled |
+//----------------------------------------------------------------------------+
+inline void SteerTo(int* angle) {
+	if (!Steer(*angle)) {
+		*angle = nxt_motor_get_count(STEER_MOTOR);
+	}
+}
+
+//----------------------------------------------------------------------------+
+// EdgeNudge: Steers NUDGE further towards drift_dir without stopping, gives  |
+// up and stops the car if the line is lost before the wheels get there       |
+//----------------------------------------------------------------------------+
+void EdgeNudge() {
+	// MotorRevControl can't steer while it is counting down a timeout
+	if (drift_dir == STRAIGHT || countdown) { return; }
+	
+	int target = drift_angle + drift_dir * NUDGE;
+	if (target > HARD) { target = HARD; }
+	if (target < -HARD) { target = -HARD; }
+	if (target == drift_angle) { return; }
+	
+	bool was_rolling = rolling;
+	rolling = true;
+	drift_angle = SteerUntil(target, LineUpdateEvent) ? target : nxt_motor_get_count(STEER_MOTOR);
+	rolling = was_rolling;
+	drift_nudged = true;
+	TelemetryPost(TLM_EDGE, 1, drift_angle);
+}
+
+//----------------------------------------------------------------------------+
+// EdgeFollowStart / EdgeFollowEnd: Let FollowLine nudge the steering towards |
+// `dir` when the edge estimator sees the car drifting off the line. End      |
+// returns true if it did, with the wheels' angle left in drift_angle         |
+//----------------------------------------------------------------------------+
+void EdgeFollowStart(int dir) {
+	drift_angle = nxt_motor_get_count(STEER_MOTOR);
+	drift_nudged = false;
+	drift_dir = dir;
+}
+bool EdgeFollowEnd() {
+	drift_dir = STRAIGHT;
+	return drift_nudged;
+}
+
 //----------------------------------------------------------------------------+
 // FollowLine: Drive until loosing the line or hitting the timeout (0 => inf) |
-// returns true: If the line is lost before the time runs out                 |
+// returns true: If the line is lost before the time runs out, false on a     |
+// timeout or a motor stall                                                   |
 //----------------------------------------------------------------------------+
 bool FollowLine(int speed, int direction, unsigned int timeout) {
 	// Clear any previous driving command (should be a no-op but safety first)
 	countdown = 0;
-	ClearEvent(TimerCompleteEvent);
+	ClearEvent(TimerCompleteEvent | MotorFailEvent | EdgeDriftEvent);
 	
 	// Set the countdown timer
 	countdown = timeout;
+	LatSet(TLM_LAT_TIMER_START);
 	SetEvent(MotorRevControl, TimerStartEvent);
 	
 	// Get the motor's going
 	velocity = speed * direction;
+	LatSet(TLM_LAT_MOTOR_START);
 	SetEvent(MotorSpeedControl, MotorStartEvent);
 	
 	// Wait for the timer or line found
 	while (1) {
-		WaitEvent(TimerCompleteEvent | LineUpdateEvent);
+		WaitEvent(TimerCompleteEvent | LineUpdateEvent | MotorFailEvent | EdgeDriftEvent);
 		
 		EventMaskType eMask = 0;
 		GetEvent(LineFollower, &eMask);
+		LatWakeOn(eMask, LineUpdateEvent, TLM_LAT_LINE_UPDATE);
+		LatWakeOn(eMask, TimerCompleteEvent, TLM_LAT_TIMER_COMPLETE);
 		
-		if (eMask & LineUpdateEvent && on_line) {
+		// Correct on the move while the line is still under the sensor
+		if (eMask & EdgeDriftEvent) {
+			ClearEvent(EdgeDriftEvent);
+			if (!(eMask & (TimerCompleteEvent | LineUpdateEvent | MotorFailEvent))) {
+				EdgeNudge();
+				continue;
+			}
+		}
+		
+		if (eMask & LineUpdateEvent && on_line && !(eMask & MotorFailEvent)) {
 			ClearEvent(LineUpdateEvent);
 			continue; 
 		}
 		
-		// Stop now that we've hit our timer or lost the line
-		SetEvent(MotorSpeedControl, MotorStopEvent);
+		// Stop now that we've hit our timer or lost the line (unless rolling on)
+		if (!rolling || eMask & MotorFailEvent) {
+			LatSet(TLM_LAT_MOTOR_STOP);
+			SetEvent(MotorSpeedControl, MotorStopEvent);
+		}
 		
 		countdown = 0;
 		ClearEvent(TimerCompleteEvent);
 		ClearEvent(LineUpdateEvent);
+		ClearEvent(MotorFailEvent);
+		ClearEvent(EdgeDriftEvent);
 		
-		return eMask & LineUpdateEvent ? true : false;
+		return eMask & LineUpdateEvent && !(eMask & MotorFailEvent) ? true : false;
 	}
 }
 
 //----------------------------------------------------------------------------+
 // SeekLine: Drive until finding the line or hitting the timeout              |
-// returns true: If the line is found before the time runs out                |
+// returns true: If the line is found before the time runs out, false on a    |
+// timeout or a motor stall                                                   |
 //----------------------------------------------------------------------------+
 bool SeekLine(int speed, int direction, unsigned int timeout) {
 	// Clear any previous driving command (should be a no-op but safety first)
 	countdown = 0;
-	ClearEvent(TimerCompleteEvent);
+	ClearEvent(TimerCompleteEvent | MotorFailEvent);
 	
 	// Set the countdown timer
 	countdown = timeout;
+	LatSet(TLM_LAT_TIMER_START);
 	SetEvent(MotorRevControl, TimerStartEvent);
 	
 	// Get the motor's going
 	velocity = speed * direction;
+	LatSet(TLM_LAT_MOTOR_START);
 	SetEvent(MotorSpeedControl, MotorStartEvent);
 	
 	// Wait for the timer or line found
 	while (1) {
-		WaitEvent(TimerCompleteEvent | LineUpdateEvent);
+		WaitEvent(TimerCompleteEvent | LineUpdateEvent | MotorFailEvent);
 		
 		EventMaskType eMask = 0;
 		GetEvent(LineFollower, &eMask);
+		LatWakeOn(eMask, LineUpdateEvent, TLM_LAT_LINE_UPDATE);
+		LatWakeOn(eMask, TimerCompleteEvent, TLM_LAT_TIMER_COMPLETE);
 		
-		if (eMask & LineUpdateEvent && !on_line) {
+		if (eMask & LineUpdateEvent && !on_line && !(eMask & MotorFailEvent)) {
 			ClearEvent(LineUpdateEvent);
 			continue; 
 		}
 		
-		// Stop now that we've hit our timer or found the line
-		SetEvent(MotorSpeedControl, MotorStopEvent);
+		// Stop now that we've hit our timer or found the line (unless rolling on)
+		if (!rolling || eMask & MotorFailEvent) {
+			LatSet(TLM_LAT_MOTOR_STOP);
+			SetEvent(MotorSpeedControl, MotorStopEvent);
+		}
 		
 		countdown = 0;
 		ClearEvent(TimerCompleteEvent);
 		ClearEvent(LineUpdateEvent);
+		ClearEvent(MotorFailEvent);
 		
-		return eMask & LineUpdateEvent ? true : false;
+		return eMask & LineUpdateEvent && !(eMask & MotorFailEvent) ? true : false;
 	}
 }
 
-//----------------------------------------------------------------------------+
-// Steer: Does an in-place turn and returns out when finished turning         |
-//----------------------------------------------------------------------------+
-inline void Steer(int angle) {
-	// Stop to simplify logic (should be a no-op but safety first)
-	SetEvent(MotorSpeedControl, MotorStopEvent);
-	
-	steer_target = angle;
-	SetEvent(MotorRevControl, SteerStartEvent);
-	
-	WaitEvent(SteerCompleteEvent);
-	ClearEvent(SteerCompleteEvent);
-}
-
 //----------------------------------------------------------------------------+
 // TestForward: Attempts to find the line, reverses the test if it fails      |
 // returns true: If the line is found in the allotted time                    |
@@ -358,10 +1093,11 @@ bool SymmetricFinder(int* angle, int dir1, int bump, int minit, int maxit, int t
 	bool hard1 = false;
 	bool hard2 = false;
 	int seek_angle;
+	int tries = 0;
 	
 	while (1) {
 		++step;
-		if (maxit && step > maxit) { return false; }
+		if (maxit && step > maxit) { return FinderDone(TLM_FINDER_SYMMETRIC, tries, false); }
 		
 		if (!hard1) {
 			seek_angle = *angle + step * dir1 * bump;
@@ -371,10 +1107,11 @@ bool SymmetricFinder(int* angle, int dir1, int bump, int minit, int maxit, int t
 				hard1 = true;
 			}
 			
-			Steer(seek_angle);
-			if (TestForward(timeout)) {
+			// Skip angles the steering couldn't reach
+			++tries;
+			if (Steer(seek_angle) && TestForward(timeout)) {
 				*angle = seek_angle;
-				return true;
+				return FinderDone(TLM_FINDER_SYMMETRIC, tries, true);
 			}
 		}
 		
@@ -386,15 +1123,16 @@ bool SymmetricFinder(int* angle, int dir1, int bump, int minit, int maxit, int t
 				hard2 = true;
 			}
 			
-			Steer(seek_angle);
-			if (TestForward(timeout)) {
+			// Skip angles the steering couldn't reach
+			++tries;
+			if (Steer(seek_angle) && TestForward(timeout)) {
 				*angle = seek_angle;
-				return true;
+				return FinderDone(TLM_FINDER_SYMMETRIC, tries, true);
 			}
 		}
 		
 		if (hard1 && hard2) {
-			return false;
+			return FinderDone(TLM_FINDER_SYMMETRIC, tries, false);
 		}
 	}
 }
@@ -408,10 +1146,11 @@ bool AsymmetricFinder(int* angle, int dir, int bump, int minit, int maxit, int t
 	int step = minit;
 	bool hard = false;
 	int seek_angle;
+	int tries = 0;
 	
 	while (1) {
 		++step;
-		if (maxit && step > maxit) { return false; }
+		if (maxit && step > maxit) { return FinderDone(TLM_FINDER_ASYMMETRIC, tries, false); }
 		
 		if (!hard) {
 			seek_angle = *angle + step * dir * bump;
@@ -421,14 +1160,15 @@ bool AsymmetricFinder(int* angle, int dir, int bump, int minit, int maxit, int t
 				hard = true;
 			}
 			
-			Steer(seek_angle);
-			if (TestForward(timeout)) {
+			// Skip angles the steering couldn't reach
+			++tries;
+			if (Steer(seek_angle) && TestForward(timeout)) {
 				*angle = seek_angle;
-				return true;
+				return FinderDone(TLM_FINDER_ASYMMETRIC, tries, true);
 			}
 		}
 		else {
-			return false;
+			return FinderDone(TLM_FINDER_ASYMMETRIC, tries, false);
 		}
 	}
 }
@@ -446,12 +1186,80 @@ bool Hard3TurnFinder(int* angle, int timeout) {
 			angle_v.mag = HARD;
 		}
 		*angle = angle_v.dir * angle_v.mag;
-		Steer(*angle);
-		return true;
+		SteerTo(angle);
+		return FinderDone(TLM_FINDER_HARD3TURN, 1, true);
+	}
+	SteerTo(angle);
+	
+	return FinderDone(TLM_FINDER_HARD3TURN, 2, SeekLine(SPEED_4, FORWARD, timeout));
+}
+
+//----------------------------------------------------------------------------+
+// Maneuvers: A fixed trajectory held as a table of {steer, drive} steps      |
+// Angles are relative to the course direction, so `-TURN` steers away from   |
+// the way the course curves. A step's steer is skipped if it is unchanged.   |
+// Steps with `stop` false leave the drive motors running into the next step, |
+// which then steers on the move instead of stopping first                    |
+//----------------------------------------------------------------------------+
+enum MANEUVER_MOVE {
+	MOVE_SEEK,   // SeekLine: drive until the line is found
+	MOVE_FOLLOW, // FollowLine: drive until the line is lost
+};
+typedef struct { int angle; int move; int direction; unsigned int timeout; bool stop; } ManeuverStep;
+
+// Drive around the obstacle, picking the line back up on the other side.
+// A step only rolls on into the next when that keeps the same angle and
+// direction, the rest still wait on tuning from TLM_MANEUVER on the car
+const ManeuverStep obstacle_plan[] = {
+	// Swing out and around the obstacle
+	{ -TURN,    MOVE_SEEK,   FORWARD, 25, true },
+	{ STRAIGHT, MOVE_SEEK,   FORWARD, 20, true },
+	{ SOFT,     MOVE_SEEK,   FORWARD, 75, true },
+	{ HARD,     MOVE_SEEK,   FORWARD, 0,  true },
+	
+	// Get our back wheels to the line
+	{ -BUMP,    MOVE_FOLLOW, FORWARD, 0,  true },
+	{ STRAIGHT, MOVE_SEEK,   FORWARD, DURATION_STRAIGHTENER * 3, true },
+	
+	// Back up into the line
+	{ HARD,     MOVE_SEEK,   REVERSE, 0,  true },
+	
+	// Turn into the corner, no need to brake between following and seeking
+	{ -MEDIUM,  MOVE_FOLLOW, FORWARD, 0,  false },
+	{ -MEDIUM,  MOVE_SEEK,   FORWARD, 0,  true },
+};
+
+//----------------------------------------------------------------------------+
+// RunManeuver: Executes `plan` step by step, reporting each step's duration  |
+//----------------------------------------------------------------------------+
+void RunManeuver(const ManeuverStep* plan, int steps, int course_dir) {
+	int i;
+	for (i = 0; i < steps; ++i) {
+		const ManeuverStep* step = &plan[i];
+		U32 start = ecrobot_get_systick_ms();
+		
+		// `rolling` is still the previous step's choice while steering
+		if (i == 0 || step->angle != plan[i - 1].angle) {
+			Steer(course_dir * step->angle);
+		}
+		
+		rolling = !step->stop;
+		if (step->move == MOVE_FOLLOW) {
+			FollowLine(SPEED_4, step->direction, step->timeout);
+		}
+		else {
+			SeekLine(SPEED_4, step->direction, step->timeout);
+		}
+		
+		TelemetryPost(TLM_MANEUVER, i, ecrobot_get_systick_ms() - start);
 	}
-	Steer(*angle);
 	
-	return SeekLine(SPEED_4, FORWARD, timeout);
+	// Never leave the car moving past the end of the plan
+	if (rolling) {
+		rolling = false;
+		LatSet(TLM_LAT_MOTOR_STOP);
+		SetEvent(MotorSpeedControl, MotorStopEvent);
+	}
 }
 
 //----------------------------------------------------------------------------+
@@ -469,8 +1277,10 @@ TASK(LineFollower) {
 	int course_dir = LEFT;
 	int bump_dir = LEFT;
 	
+	course_start = ecrobot_get_systick_ms();
+	
 	// Follow a straight line
-	state = 1;
+	SetState(1);
 	while (1) {
 		FollowLine(SPEED_4, FORWARD, 0);
 		drive_last = drive.now;
@@ -485,6 +1295,7 @@ TASK(LineFollower) {
 		
 		if (!find) {
 			debug = 0;
+			CourseEnd(false);
 			TerminateTask();
 			return;
 		}
@@ -497,7 +1308,7 @@ TASK(LineFollower) {
 		bump_dir = delta.dir;
 		
 		// Advance to the next stage after a significant turn
-		if (drive_delta.mag > THRESHOLD_CURVE_DETECTOR) {
+		if (drive_delta.mag > THRESHOLD_CURVE_DETECTOR || SegmentIs(SEG_CURVE)) {
 			course_dir = bump_dir;
 			angle_next = angle = course_dir * TURN;
 			break;
@@ -505,13 +1316,22 @@ TASK(LineFollower) {
 	}
 	
 	// Follow a curved line
-	state = 2;
+	SetState(2);
 	while (1) {
+		EdgeFollowStart(bump_dir);
 		FollowLine(SPEED_4, FORWARD, 0);
+		if (EdgeFollowEnd()) {
+			angle_next = angle = drift_angle;
+		}
 		
+		// Size the corrections by how steeply we ran off the line, but no
+		// bigger than BUMP: the exit to the dashed line below relies on a
+		// BUMP sized step taking a TURN angle back under BUMP
+		int bump = EdgeBump();
+		if (bump > BUMP) { bump = BUMP; }
 		find =
-			AsymmetricFinder(&angle_next,  bump_dir, BUMP, 1, 3, DURATION_STRAIGHTENER) ||
-			AsymmetricFinder(&angle_next, -bump_dir, BUMP, 1, 3, DURATION_STRAIGHTENER);
+			AsymmetricFinder(&angle_next,  bump_dir, bump, 1, 3, DURATION_STRAIGHTENER) ||
+			AsymmetricFinder(&angle_next, -bump_dir, bump, 1, 3, DURATION_STRAIGHTENER);
 		
 		if (!find) {
 			angle_next = STRAIGHT;
@@ -530,6 +1350,7 @@ TASK(LineFollower) {
 		
 		if (!find) {
 			debug = 0;
+			CourseEnd(false);
 			TerminateTask();
 			return;
 		}
@@ -543,17 +1364,22 @@ TASK(LineFollower) {
 		
 		vector angle_v = GetVector(angle);
 		
-		if (angle_v.mag < BUMP) {
+		if (angle_v.mag < BUMP || SegmentIs(SEG_DASHED)) {
 			angle_next = angle = STRAIGHT;
 			break;
 		}
 	}
 	
 	// Follow a dashed line
-	state = 3;
+	SetState(3);
 	while (1) {
 		FollowLine(SPEED_4, FORWARD, 0);
 		
+		if (SegmentIs(SEG_SHARP)) {
+			angle_next = -course_dir * HARD;
+			break;
+		}
+		
 		if (TestForward(DURATION_DASHED_FINDER)) { continue; }
 		
 		angle_next = STRAIGHT;
@@ -573,7 +1399,7 @@ TASK(LineFollower) {
 	}
 	
 	// Make a sharp turn
-	state = 4;
+	SetState(4);
 	while (1) {
 		find = Hard3TurnFinder(&angle_next, DURATION_STRAIGHTENER);
 		
@@ -588,37 +1414,15 @@ TASK(LineFollower) {
 	
 	if (!obstacle) {
 		debug = -1;
+		CourseEnd(false);
 		TerminateTask();
 		return;
 	}
 	
 	// the obstacle
-	state = 5;
-	
-	Steer(-course_dir * TURN);
-	SeekLine(SPEED_4, FORWARD, 25);
-	Steer(STRAIGHT);
-	SeekLine(SPEED_4, FORWARD, 20);
-	Steer(course_dir * SOFT);
-	SeekLine(SPEED_4, FORWARD, 75);
-	Steer(course_dir * HARD);
-	SeekLine(SPEED_4, FORWARD, 0);
+	SetState(5);
 	
-	// Get our back wheels to the line
-	Steer(-course_dir * BUMP);
-	FollowLine(SPEED_4, FORWARD, 0);
-	
-	Steer(STRAIGHT);
-	SeekLine(SPEED_4, FORWARD, DURATION_STRAIGHTENER * 3);
-	
-	// Back up into the line
-	Steer(course_dir * HARD);
-	SeekLine(SPEED_4, REVERSE, 0);
-	
-	// Turn into the corner
-	Steer(-course_dir * MEDIUM);
-	FollowLine(SPEED_4, FORWARD, 0);
-	SeekLine(SPEED_4, FORWARD, 0);
+	RunManeuver(obstacle_plan, sizeof(obstacle_plan) / sizeof(obstacle_plan[0]), course_dir);
 	
 	angle_next = angle = -course_dir * HARD;
 	
@@ -627,13 +1431,19 @@ TASK(LineFollower) {
 	
 	// Follow a curved line
 	int nobackupcnt = 0;
-	state = 2;
+	SetState(2);
 	while (1) {
+		EdgeFollowStart(bump_dir);
 		FollowLine(SPEED_4, FORWARD, 0);
+		if (EdgeFollowEnd()) {
+			angle_next = angle = drift_angle;
+		}
 		
+		// Size the corrections by how steeply we ran off the line
+		int bump = EdgeBump();
 		find =
-			AsymmetricFinder(&angle_next,  bump_dir, BUMP, 1, 3, DURATION_STRAIGHTENER) ||
-			AsymmetricFinder(&angle_next, -bump_dir, BUMP, 1, 3, DURATION_STRAIGHTENER);
+			AsymmetricFinder(&angle_next,  bump_dir, bump, 1, 3, DURATION_STRAIGHTENER) ||
+			AsymmetricFinder(&angle_next, -bump_dir, bump, 1, 3, DURATION_STRAIGHTENER);
 		
 		if (!find) {
 			angle_next = STRAIGHT;
@@ -652,7 +1462,7 @@ TASK(LineFollower) {
 		}
 		else {
 			++nobackupcnt;
-			if (nobackupcnt > 2) {
+			if (nobackupcnt > 2 || SegmentIs(SEG_DASHED)) {
 				break;
 			}
 		}
@@ -671,15 +1481,17 @@ TASK(LineFollower) {
 		bump_dir = delta.dir;
 	}
 	
-	state = 3;
+	SetState(3);
 	while (1) {
 		int revcnt_before = drive.now;
 		FollowLine(SPEED_4, FORWARD, 0);
 		int revcnt_after = drive.now;
 		
+		// Size the corrections by how steeply we ran off the line
+		int bump = EdgeBump();
 		find =
-			AsymmetricFinder(&angle_next,  bump_dir, BUMP, 1, 3, DURATION_STRAIGHTENER) ||
-			AsymmetricFinder(&angle_next, -bump_dir, BUMP, 1, 3, DURATION_STRAIGHTENER);
+			AsymmetricFinder(&angle_next,  bump_dir, bump, 1, 3, DURATION_STRAIGHTENER) ||
+			AsymmetricFinder(&angle_next, -bump_dir, bump, 1, 3, DURATION_STRAIGHTENER);
 		
 		if (!find) {
 			angle_next = STRAIGHT;
@@ -704,13 +1516,13 @@ TASK(LineFollower) {
 		// Expect the next turn to be the same direction as the last
 		bump_dir = delta.dir;
 		
-		if (delta.mag > 800) {
+		if (delta.mag > 800 || SegmentIs(SEG_STRAIGHT)) {
 			break;
 		}
 	}
 	
 	// Follow a straight line
-	state = 1;
+	SetState(1);
 	while (1) {
 		FollowLine(SPEED_4, FORWARD, 0);
 		drive_last = drive.now;
@@ -725,6 +1537,7 @@ TASK(LineFollower) {
 		
 		if (!find) {
 			debug = 0;
+			CourseEnd(false);
 			TerminateTask();
 			return;
 		}
@@ -737,13 +1550,14 @@ TASK(LineFollower) {
 		bump_dir = delta.dir;
 		
 		// Advance to the next stage after a significant turn
-		if (drive_delta.mag > THRESHOLD_CURVE_DETECTOR) {
+		if (drive_delta.mag > THRESHOLD_CURVE_DETECTOR || SegmentIs(SEG_CURVE)) {
 			course_dir = bump_dir;
 			angle_next = angle = course_dir * TURN;
 			break;
 		}
 	}
 	
+	CourseEnd(true);
 	while (1) {
 		SeekLine(SPEED_4, FORWARD, 0);
 		FollowLine(SPEED_4, FORWARD, 0);
@@ -752,6 +1566,35 @@ TASK(LineFollower) {
 	TerminateTask();
 }
 
+//----------------------------------------------------------------------------+
+// SteerStep: One RevCheckEvent worth of driving the steering to steer_target |
+// returns true: If the target is reached and the steering motor is stopped   |
+//----------------------------------------------------------------------------+
+bool SteerStep() {
+	int steer_current = nxt_motor_get_count(STEER_MOTOR);
+	vector delta = GetVector(steer_target - steer_current);
+	
+	// Adjust the steering motor
+	if (delta.mag > 5) {
+		int speed;
+		if (delta.mag > 30) {
+			speed = 80;
+		}
+		else if (delta.mag > 15) {
+			speed = 70;
+		}
+		else {
+			speed = 60;
+		}
+		
+		nxt_motor_set_speed(STEER_MOTOR, speed * delta.dir, 0);
+		return false;
+	}
+	
+	nxt_motor_set_speed(STEER_MOTOR, STOPPED, 1);
+	return true;
+}
+
 //----------------------------------------------------------------------------+
 // MotorRevControl - aperiodic task while(1), event-driven, priority 5        |
 //----------------------------------------------------------------------------+
@@ -760,6 +1603,8 @@ TASK(MotorRevControl) {
 	while (1) {
 		WaitEvent(SteerStartEvent | DriveStartEvent | TimerStartEvent);
 		GetEvent(MotorRevControl, &eMask);
+		LatWakeOn(eMask, TimerStartEvent, TLM_LAT_TIMER_START);
+		LatWakeOn(eMask, SteerStartEvent, TLM_LAT_STEER_START);
 		
 		if (eMask & TimerStartEvent) {
 			ClearEvent(TimerStartEvent);
@@ -775,6 +1620,7 @@ TASK(MotorRevControl) {
 				if (countdown == 0) { break; }
 				
 				if (--countdown == 0) {
+					LatSet(TLM_LAT_TIMER_COMPLETE);
 					SetEvent(LineFollower, TimerCompleteEvent);
 				}
 			}
@@ -792,12 +1638,15 @@ TASK(MotorRevControl) {
 				// Adjust the driving motors
 				if (delta.mag > 0) {
 					velocity = SPEED_4 * delta.dir;
+					LatSet(TLM_LAT_MOTOR_START);
 					SetEvent(MotorSpeedControl, MotorStartEvent);
 				}
 				
 				// Signal that steering is complete
 				else {
+					LatSet(TLM_LAT_MOTOR_STOP);
 					SetEvent(MotorSpeedControl, MotorStopEvent);
+					LatSet(TLM_LAT_STEER_COMPLETE);
 					SetEvent(LineFollower, SteerCompleteEvent);
 					break;
 				}
@@ -806,33 +1655,28 @@ TASK(MotorRevControl) {
 		
 		if (eMask & SteerStartEvent) {
 			ClearEvent(SteerStartEvent);
+			U32 steer_start = ecrobot_get_systick_ms();
+			int steer_last = nxt_motor_get_count(STEER_MOTOR);
+			int steer_stuck = 0;
 			while (1) {
 				WaitEvent(RevCheckEvent);
 				ClearEvent(RevCheckEvent);
 				
-				int steer_current = nxt_motor_get_count(STEER_MOTOR);
-				vector delta = GetVector(steer_target - steer_current);
-				
-				// Adjust the steering motor
-				if (delta.mag > 5) {
-					int speed;
-					if (delta.mag > 30) {
-						speed = 80;
-					}
-					else if (delta.mag > 15) {
-						speed = 70;
-					}
-					else {
-						speed = 60;
-					}
-					
-					nxt_motor_set_speed(STEER_MOTOR, speed * delta.dir, 0);
+				// Signal that steering is complete
+				if (SteerStep()) {
+					TelemetryPost(TLM_STEER, 0, ecrobot_get_systick_ms() - steer_start);
+					LatSet(TLM_LAT_STEER_COMPLETE);
+					SetEvent(LineFollower, SteerCompleteEvent);
+					break;
 				}
 				
-				// Signal that steering is complete
-				else {
+				// Give up if the motor is powered but hasn't moved for a while
+				int steer_now = nxt_motor_get_count(STEER_MOTOR);
+				steer_stuck = abs(steer_now - steer_last) < STALL_MIN_COUNTS ? steer_stuck + 1 : 0;
+				steer_last = steer_now;
+				if (steer_stuck >= STALL_PERIODS) {
 					nxt_motor_set_speed(STEER_MOTOR, STOPPED, 1);
-					SetEvent(LineFollower, SteerCompleteEvent);
+					MotorFail(FAULT_STEER);
 					break;
 				}
 			}
@@ -850,12 +1694,15 @@ TASK(MotorSpeedControl) {
 	while(1) {
 		WaitEvent(MotorStartEvent | MotorStopEvent);
 		GetEvent(MotorSpeedControl, &eMask);
+		LatWakeOn(eMask, MotorStartEvent, TLM_LAT_MOTOR_START);
+		LatWakeOn(eMask, MotorStopEvent, TLM_LAT_MOTOR_STOP);
 		
 		if (eMask & MotorStartEvent) {
 			ClearEvent(MotorStartEvent);
 			
 			nxt_motor_set_speed(LEFT_MOTOR, velocity, 0);
 			nxt_motor_set_speed(RIGHT_MOTOR, velocity, 0);
+			drive_active = velocity != STOPPED;
 		}
 		
 		if (eMask & MotorStopEvent) {
@@ -863,6 +1710,7 @@ TASK(MotorSpeedControl) {
 			
 			nxt_motor_set_speed(LEFT_MOTOR, STOPPED, 1);
 			nxt_motor_set_speed(RIGHT_MOTOR, STOPPED, 1);
+			drive_active = false;
 		}
 	}
 	
@@ -0,0 +1,62 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+//----------------------------------------------------------------------------+
+// Telemetry wire format, shared by skeleton.c and host/telemetry_rx.c        |
+//                                                                            |
+// Every frame is TLM_FRAME_SIZE bytes, multi-byte fields are little-endian:  |
+//   [0]    TLM_SYNC                                                          |
+//   [1]    type (enum TLM_TYPE)                                              |
+//   [2]    arg   - meaning depends on type                                   |
+//   [3]    seq   - increments per frame, gaps mean dropped frames            |
+//   [4..5] value - signed 16 bit, meaning depends on type                    |
+//   [6..9] tick  - ms since boot when the frame was posted                   |
+//----------------------------------------------------------------------------+
+#define TLM_SYNC        0xA5
+#define TLM_FRAME_SIZE  10
+
+enum TLM_TYPE {
+	TLM_STATE    = 1,  // arg: new state,            value: split, 100ms units
+	TLM_FINDER   = 2,  // arg: TLM_FINDER_ID|found,  value: steer attempts made
+	TLM_STEER    = 3,  // arg: unused,               value: ms to settle on target
+	TLM_LAP      = 4,  // arg: 1 done / 0 aborted,   value: lap time, 100ms units
+	TLM_DROP     = 5,  // arg: unused,               value: frames dropped so far
+	TLM_DISPLAY  = 6,  // arg: DISP_FIELD index,     value: LCD field (RACE_MODE)
+	TLM_LATENCY  = 7,  // arg: pair << 4 | bucket,   value: count, or worst case
+	                   //                            in 100us for TLM_LAT_MAX
+	TLM_SEGMENT  = 8,  // arg: SEGMENT now in force, value: margin over runner-up
+	TLM_FEATURE  = 9,  // arg: SEG_FEATURE index,    value: feature at line loss
+	TLM_MANEUVER = 10, // arg: plan step index,      value: ms the step took
+	TLM_FAULT    = 11, // arg: MOTOR_FAULT,          value: state it happened in
+	TLM_CPU      = 12, // arg: CPU utilization in %, value: idle ms this period
+	TLM_EDGE     = 13, // arg: 0 line lost,          value: exit rate
+	                   // arg: 1 on-line nudge,      value: new steer angle
+};
+
+enum TLM_FINDER_ID {
+	TLM_FINDER_SYMMETRIC  = 1,
+	TLM_FINDER_ASYMMETRIC = 2,
+	TLM_FINDER_HARD3TURN  = 3,
+	TLM_FINDER_FOUND      = 0x80,
+};
+
+// SetEvent -> WaitEvent handoffs with a latency histogram on the robot
+enum TLM_LAT_PAIR {
+	TLM_LAT_LINE_UPDATE    = 0, // ReadSensors      -> LineFollower
+	TLM_LAT_TIMER_START    = 1, // LineFollower     -> MotorRevControl
+	TLM_LAT_TIMER_COMPLETE = 2, // MotorRevControl  -> LineFollower
+	TLM_LAT_STEER_START    = 3, // LineFollower     -> MotorRevControl
+	TLM_LAT_STEER_COMPLETE = 4, // MotorRevControl  -> LineFollower
+	TLM_LAT_STEER_ROUND    = 5, // Steer() call     -> Steer() return
+	TLM_LAT_MOTOR_START    = 6, // any              -> MotorSpeedControl
+	TLM_LAT_MOTOR_STOP     = 7, // any              -> MotorSpeedControl
+	TLM_LAT_PAIRS          = 8,
+};
+
+// Bucket b counts latencies below TLM_LAT_FIRST_US << 2b, the last bucket
+// counts everything longer (64us, 256us, 1ms, 4ms, 16ms, 65ms, 262ms, more)
+#define TLM_LAT_BUCKETS   8
+#define TLM_LAT_FIRST_US  64
+#define TLM_LAT_MAX       0xF
+
+#endif